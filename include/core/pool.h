@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* implemented in src/core/pool.c3 */
+typedef void (*pool_task)(void *ctx, uint32_t index, size_t thread);
+
+uint32_t pool_threads(void);
+void pool_parallel_for(uint32_t start, uint32_t end, pool_task task, void *ctx);
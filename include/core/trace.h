@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#pragma once
+
+#include <stdint.h>
+
+/* implemented in src/core/trace.c3, name must outlive the trace */
+uint64_t trace_begin(void);
+void trace_end(const char *name, uint64_t start);
+/* after joining the native thread that traced */
+void trace_release_native(void);
@@ -1,62 +1,164 @@
 -- SPDX-License-Identifier: GPL-3.0-or-later
 
 local PENDING = 1
-local FAILED = 2 
+local FAILED = 2
 local SUCCESS = 3
 
-local jobs = {}
+-- yielded by jobs waiting on a promise, timer or I/O
+local WAIT = {}
 
+local now = __OpenPNGStudio_DO_NOT_POKE_now
+local preempt = __OpenPNGStudio_DO_NOT_POKE_preempt
+
+-- jobs are preempted by a count hook, which never fires inside compiled traces
+if jit ~= nil then
+    jit.off()
+    jit.flush()
+end
+local unpack = unpack or table.unpack
+
+local jobs = {} -- id -> suspended or ready job
+local ready = { first = 1, last = 0 }
+local next_id = 1
+local current = nil
+
+local function push(job)
+    ready.last = ready.last + 1
+    ready[ready.last] = job
+end
+
+local function pop()
+    if ready.first > ready.last then
+        return nil
+    end
+
+    local job = ready[ready.first]
+    ready[ready.first] = nil
+    ready.first = ready.first + 1
+
+    return job
+end
+
+local function finish(job, status, result)
+    job.prom.status = status
+    job.prom.result = result
+    jobs[job.id] = nil
+
+    for _, waiter in ipairs(job.prom.waiters) do
+        push(waiter)
+    end
+
+    job.prom.waiters = {}
+end
+
+-- plain yield() keeps the job ready, it continues next frame
 yield = coroutine.yield
-function async(fn)
+
+function async(fn, ...)
+    local args = { ... }
+    local nargs = select("#", ...)
+
     local prom = {
         status = PENDING,
         result = nil,
-        work = fn,
-        coro = nil,
+        waiters = {},
     }
 
-    table.insert(jobs, prom)
+    local job = {
+        id = next_id,
+        prom = prom,
+        value = nil,
+        coro = coroutine.create(function()
+            return fn(unpack(args, 1, nargs))
+        end),
+    }
+
+    next_id = next_id + 1
+    jobs[job.id] = job
+    push(job)
 
     return prom
 end
 
 function await(prom)
-    while prom.status == PENDING do
-        yield()
+    if prom.status == PENDING then
+        assert(current ~= nil, "await called outside of an async job")
+        table.insert(prom.waiters, current)
+        coroutine.yield(WAIT)
+    end
+
+    if prom.status == FAILED then
+        error(prom.result, 0)
     end
 
     return prom.result
 end
 
-local function runtime()
-    while true do
-        for i, job in pairs(jobs) do
-            if job.status == PENDING then
-                if job.coro == nil then
-                    job.coro = coroutine.create(job.work)
-                end
-                res, val = coroutine.resume(job.coro)
-                if res and coroutine.status(job.coro) == "dead" then
-                    job.status = SUCCESS
-                    job.result = val
-                elseif res == false then
-                    error("Error handling not implemented!")
-                end
-            end
-        end
+-- suspends the current job, backed by a timer on the app event loop
+function sleep(ms)
+    assert(current ~= nil, "sleep called outside of an async job")
+    __OpenPNGStudio_DO_NOT_POKE_timer(ms, current.id)
+    coroutine.yield(WAIT)
+end
 
-        yield()
+-- reads a whole file on a worker thread, nil when it can't be read
+function read_file(path)
+    assert(current ~= nil, "read_file called outside of an async job")
+    __OpenPNGStudio_DO_NOT_POKE_read_file(path, current.id)
+    return coroutine.yield(WAIT)
+end
+
+function __OpenPNGStudio_DO_NOT_POKE_rt_wake(id, value)
+    local job = jobs[id]
+    if job == nil then
+        return
     end
+
+    job.value = value
+    push(job)
 end
 
-local rt = coroutine.create(runtime)
 local scripts = {}
 
-function __OpenPNGStudio_DO_NOT_POKE_rt_spin_once()
-    local req = __OpenPNGStudio_DO_NOT_POKE_script_load_req() -- nil or string for script name
-    if req ~= nil then
+local function find_script(req)
+    if req:sub(-4) == ".lua" then
+        return req
+    end
+
+    return package.searchpath(req, package.path)
+end
+
+local function fail_load(req, err)
+    __OpenPNGStudio_DO_NOT_POKE_console_error("(lua) runtime", 0,
+        string.format("Failed to load %s: %s", req, tostring(err)))
+end
+
+-- the chunk runs as a job, so its top level is preempted like everything else
+-- (require and dofile would run it behind a C call that can't yield)
+local function load_script(req)
+    async(function()
+        local path, err = find_script(req)
+        if path == nil then
+            return fail_load(req, err)
+        end
+
+        local chunk, load_err = loadfile(path)
+        if chunk == nil then
+            return fail_load(req, load_err)
+        end
+
+        local ok, mod = pcall(chunk, req)
+        if not ok or type(mod) ~= "table" then
+            return fail_load(req, mod)
+        end
+
+        if path ~= req then
+            package.loaded[req] = mod
+        end
+
         local script = {
-            mod = require(req),
+            name = req,
+            mod = mod,
             update_prom = nil
         }
 
@@ -65,16 +167,64 @@ function __OpenPNGStudio_DO_NOT_POKE_rt_spin_once()
         end
 
         table.insert(scripts, script)
+    end)
+end
+
+local function resume(job, deadline)
+    current = job
+    preempt(job.coro, deadline)
+
+    local ok, val
+    if job.value ~= nil then
+        ok, val = coroutine.resume(job.coro, job.value)
+    else
+        -- also the case for jobs preempted by the hook
+        ok, val = coroutine.resume(job.coro)
     end
 
-    coroutine.resume(rt)
+    -- the hook is global to the VM, keep it out of the scheduler and wakeups
+    preempt(nil)
+    current = nil
+    job.value = nil
 
-    for _, script in pairs(scripts) do
-        if script.mod.update ~= nil then
-            if script.update_prom.status == SUCCESS then
-                -- restart async
-                script.update_prom = async(script.mod.update)
-            end
+    if not ok then
+        __OpenPNGStudio_DO_NOT_POKE_console_error("(lua) runtime", 0,
+            debug.traceback(job.coro, tostring(val)))
+        finish(job, FAILED, val)
+    elseif coroutine.status(job.coro) == "dead" then
+        finish(job, SUCCESS, val)
+    elseif val ~= WAIT then
+        -- plain yield() or preempted, continues next frame
+        push(job)
+    end
+end
+
+-- budget in ms, jobs woken, yielding or preempted during this pass run next
+-- frame
+function __OpenPNGStudio_DO_NOT_POKE_rt_spin_once(budget)
+    local req = __OpenPNGStudio_DO_NOT_POKE_script_load_req()
+    while req ~= nil do
+        load_script(req)
+        req = __OpenPNGStudio_DO_NOT_POKE_script_load_req()
+    end
+
+    for _, script in ipairs(scripts) do
+        local prom = script.update_prom
+        if prom ~= nil and prom.status == SUCCESS then
+            -- restart async
+            script.update_prom = async(script.mod.update)
+        elseif prom ~= nil and prom.status == FAILED then
+            __OpenPNGStudio_DO_NOT_POKE_console_warn("(lua) runtime", 0,
+                string.format("Disabled update of %s", script.name))
+            script.update_prom = nil
         end
     end
+
+    local deadline = now() + budget
+    local count = ready.last - ready.first + 1
+
+    while count > 0 and now() < deadline do
+        resume(pop(), deadline)
+        count = count - 1
+    end
 end
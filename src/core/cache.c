@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define CACHE_EXT ".tex"
+#define TMP_EXT ".tmp"
+
+struct cache_file {
+    char *path;
+    uint64_t mtime;
+    size_t size;
+};
+
+static int by_mtime(const void *a, const void *b)
+{
+    const struct cache_file *fa = a;
+    const struct cache_file *fb = b;
+
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static bool ends_with(const char *name, const char *ext)
+{
+    size_t len = strlen(name);
+    size_t ext_len = strlen(ext);
+
+    return len > ext_len && strcmp(name + len - ext_len, ext) == 0;
+}
+
+/* <sha256>.tex.<id>.tmp, left behind when a write never finished */
+static bool is_leftover(const char *name)
+{
+    return ends_with(name, TMP_EXT) && strstr(name, CACHE_EXT ".") != NULL;
+}
+
+static void remove_leftover(const char *dir, const char *name, char sep)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%c%s", dir, sep, name);
+    remove(path);
+}
+
+#ifndef _WIN32
+
+void *cache_map(const char *path, size_t *size)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    /* private + writable so raylib can touch the pixels without hitting disk */
+    void *ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    *size = st.st_size;
+    return ptr;
+}
+
+void cache_unmap(void *ptr, size_t size)
+{
+    munmap(ptr, size);
+}
+
+void cache_touch(const char *path)
+{
+    utime(path, NULL);
+}
+
+static size_t collect(const char *dir, struct cache_file **out, size_t *total,
+    bool purge)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return 0;
+
+    size_t len = 0, cap = 0;
+    struct dirent *ent;
+    struct stat st;
+
+    while ((ent = readdir(d)) != NULL) {
+        if (purge && is_leftover(ent->d_name)) {
+            remove_leftover(dir, ent->d_name, '/');
+            continue;
+        }
+
+        if (!ends_with(ent->d_name, CACHE_EXT))
+            continue;
+
+        size_t path_len = strlen(dir) + strlen(ent->d_name) + 2;
+        char *path = malloc(path_len);
+        snprintf(path, path_len, "%s/%s", dir, ent->d_name);
+
+        if (stat(path, &st) < 0) {
+            free(path);
+            continue;
+        }
+
+        if (len == cap) {
+            cap = cap ? cap * 2 : 32;
+            *out = realloc(*out, sizeof(**out) * cap);
+        }
+
+        (*out)[len++] = (struct cache_file) {
+            .path = path,
+            .mtime = (uint64_t) st.st_mtime,
+            .size = (size_t) st.st_size,
+        };
+        *total += st.st_size;
+    }
+
+    closedir(d);
+    return len;
+}
+
+#else
+
+void *cache_map(const char *path, size_t *size)
+{
+    LARGE_INTEGER file_size;
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    /* the view keeps the mapping alive */
+    void *ptr = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (ptr == NULL)
+        return NULL;
+
+    *size = (size_t) file_size.QuadPart;
+    return ptr;
+}
+
+void cache_unmap(void *ptr, size_t size)
+{
+    (void) size;
+    UnmapViewOfFile(ptr);
+}
+
+void cache_touch(const char *path)
+{
+    FILETIME now;
+    HANDLE file = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(file, NULL, NULL, &now);
+    CloseHandle(file);
+}
+
+static size_t collect(const char *dir, struct cache_file **out, size_t *total,
+    bool purge)
+{
+    WIN32_FIND_DATAA data;
+    char pattern[MAX_PATH];
+
+    if (purge) {
+        snprintf(pattern, sizeof(pattern), "%s\\*" CACHE_EXT ".*" TMP_EXT, dir);
+
+        HANDLE find = FindFirstFileA(pattern, &data);
+        if (find != INVALID_HANDLE_VALUE) {
+            do {
+                if (is_leftover(data.cFileName))
+                    remove_leftover(dir, data.cFileName, '\\');
+            } while (FindNextFileA(find, &data));
+
+            FindClose(find);
+        }
+    }
+
+    snprintf(pattern, sizeof(pattern), "%s\\*" CACHE_EXT, dir);
+
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE)
+        return 0;
+
+    size_t len = 0, cap = 0;
+
+    do {
+        /* the pattern also matches longer extensions on Windows */
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY
+            || !ends_with(data.cFileName, CACHE_EXT))
+            continue;
+
+        size_t path_len = strlen(dir) + strlen(data.cFileName) + 2;
+        char *path = malloc(path_len);
+        snprintf(path, path_len, "%s\\%s", dir, data.cFileName);
+
+        if (len == cap) {
+            cap = cap ? cap * 2 : 32;
+            *out = realloc(*out, sizeof(**out) * cap);
+        }
+
+        size_t size = ((size_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+
+        (*out)[len++] = (struct cache_file) {
+            .path = path,
+            .mtime = ((uint64_t) data.ftLastWriteTime.dwHighDateTime << 32)
+                | data.ftLastWriteTime.dwLowDateTime,
+            .size = size,
+        };
+        *total += size;
+    } while (FindNextFileA(find, &data));
+
+    FindClose(find);
+    return len;
+}
+
+#endif
+
+/* removes least recently used entries until the directory fits into limit,
+ * returns the number of evicted entries; purge also deletes leftover temporary
+ * files, only safe while no store is in flight */
+int cache_trim(const char *dir, size_t limit, size_t *remaining, bool purge)
+{
+    struct cache_file *files = NULL;
+    size_t total = 0;
+    size_t len = collect(dir, &files, &total, purge);
+    int evicted = 0;
+
+    if (total > limit) {
+        qsort(files, len, sizeof(*files), by_mtime);
+
+        for (size_t i = 0; i < len && total > limit; i++) {
+            if (remove(files[i].path) != 0)
+                continue;
+
+            total -= files[i].size;
+            evicted++;
+        }
+    }
+
+    for (size_t i = 0; i < len; i++)
+        free(files[i].path);
+    free(files);
+
+    *remaining = total;
+    return evicted;
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <core/microphone.h>
+#include <core/trace.h>
 #include <math.h>
 #include <miniaudio.h>
 #include <stdatomic.h>
@@ -53,6 +54,8 @@ void switch_device(struct microphone *self, struct device target)
 
     ma_device_stop(&device);
     ma_device_uninit(&device);
+    /* the capture thread is gone, the next one gets its trace buffer */
+    trace_release_native();
 
     config = ma_device_config_init(ma_device_type_capture);
     config.capture.pDeviceID = target.id;
@@ -105,6 +108,7 @@ void mic_free()
 static void on_data(ma_device* device, void* output, const void* input,
     ma_uint32 frame_count)
 {
+    uint64_t span = trace_begin();
     struct microphone *mic = device->pUserData;
     float *data = (float*) input;
 
@@ -116,4 +120,6 @@ static void on_data(ma_device* device, void* output, const void* input,
 
     atomic_store(&mic->volume, sqrtf(sum / frame_count) * 
         atomic_load(&mic->multiplier));
+
+    trace_end("microphone callback", span);
 }
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* instructions between two deadline checks */
+#define PREEMPT_INSTRUCTIONS 1000
+
+/* implemented in src/core/script.c3 */
+void script_native_log(int level, const char *fn_name, int line, const char *msg);
+const char *script_native_load_req(void);
+void script_native_timer(int ms, int job);
+void script_native_read_file(const char *path, int job);
+double script_native_now(void);
+
+/* lua_sethook is global to the VM, only the running job may be preempted */
+static lua_State *preempt_job;
+static double preempt_deadline;
+
+/* C functions LuaJIT can yield across, see can_yield() */
+static int yieldable_refs[2] = { LUA_NOREF, LUA_NOREF };
+
+static void report(lua_State *L)
+{
+    const char *msg = lua_tostring(L, -1);
+    script_native_log(3, "(lua) runtime", 0, msg ? msg : "unknown error");
+    lua_pop(L, 1);
+}
+
+static bool is_yieldable_cfunction(lua_State *L)
+{
+    bool yieldable = false;
+
+    for (size_t i = 0; i < sizeof(yieldable_refs) / sizeof(*yieldable_refs); i++) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, yieldable_refs[i]);
+        yieldable = yieldable || lua_rawequal(L, -1, -2);
+        lua_pop(L, 1);
+    }
+
+    return yieldable;
+}
+
+/* a yield across a C function calling back into lua (a table.sort comparator,
+ * a string.gsub replacement, ...) throws, so look for one on the stack */
+static bool can_yield(lua_State *L)
+{
+    lua_Debug ar;
+
+    for (int level = 0; lua_getstack(L, level, &ar); level++) {
+        lua_getinfo(L, "Sf", &ar);
+        bool blocked = ar.what[0] == 'C' && !is_yieldable_cfunction(L);
+        lua_pop(L, 1);
+
+        if (blocked)
+            return false;
+    }
+
+    return true;
+}
+
+/* LuaJIT lets count hooks yield, rt.lua requeues the job for the next frame;
+ * hooks don't fire in compiled traces, so rt.lua keeps the JIT off. Past the
+ * deadline every following hook tries again until the job can yield. */
+static void preempt(lua_State *L, lua_Debug *ar)
+{
+    (void) ar;
+
+    if (L != preempt_job || script_native_now() <= preempt_deadline)
+        return;
+
+    if (can_yield(L))
+        lua_yield(L, 0);
+}
+
+/* preempt(job, deadline) before resuming a job, preempt(nil) once it returns */
+static int l_preempt(lua_State *L)
+{
+    if (lua_isnoneornil(L, 1)) {
+        preempt_job = NULL;
+        lua_sethook(L, NULL, 0, 0);
+        return 0;
+    }
+
+    lua_State *co = lua_tothread(L, 1);
+    luaL_argcheck(L, co != NULL, 1, "coroutine expected");
+
+    preempt_job = co;
+    preempt_deadline = luaL_checknumber(L, 2);
+    lua_sethook(co, preempt, LUA_MASKCOUNT, PREEMPT_INSTRUCTIONS);
+    return 0;
+}
+
+#define LOG_NATIVE(name, level) \
+    static int name(lua_State *L) \
+    { \
+        script_native_log(level, luaL_checkstring(L, 1), \
+            (int) luaL_checkinteger(L, 2), luaL_checkstring(L, 3)); \
+        return 0; \
+    }
+
+LOG_NATIVE(l_debug, 0)
+LOG_NATIVE(l_info, 1)
+LOG_NATIVE(l_warn, 2)
+LOG_NATIVE(l_error, 3)
+
+static int l_load_req(lua_State *L)
+{
+    const char *req = script_native_load_req();
+
+    if (req != NULL)
+        lua_pushstring(L, req);
+    else
+        lua_pushnil(L);
+
+    return 1;
+}
+
+static int l_timer(lua_State *L)
+{
+    script_native_timer((int) luaL_checkinteger(L, 1),
+        (int) luaL_checkinteger(L, 2));
+    return 0;
+}
+
+static int l_read_file(lua_State *L)
+{
+    script_native_read_file(luaL_checkstring(L, 1),
+        (int) luaL_checkinteger(L, 2));
+    return 0;
+}
+
+static int l_now(lua_State *L)
+{
+    lua_pushnumber(L, script_native_now());
+    return 1;
+}
+
+static const luaL_Reg natives[] = {
+    { "__OpenPNGStudio_DO_NOT_POKE_console_debug", l_debug },
+    { "__OpenPNGStudio_DO_NOT_POKE_console_info", l_info },
+    { "__OpenPNGStudio_DO_NOT_POKE_console_warn", l_warn },
+    { "__OpenPNGStudio_DO_NOT_POKE_console_error", l_error },
+    { "__OpenPNGStudio_DO_NOT_POKE_script_load_req", l_load_req },
+    { "__OpenPNGStudio_DO_NOT_POKE_timer", l_timer },
+    { "__OpenPNGStudio_DO_NOT_POKE_read_file", l_read_file },
+    { "__OpenPNGStudio_DO_NOT_POKE_now", l_now },
+    { "__OpenPNGStudio_DO_NOT_POKE_preempt", l_preempt },
+    { NULL, NULL },
+};
+
+lua_State *script_host_new(const char *lua_dir)
+{
+    char rt[4096];
+    lua_State *L = luaL_newstate();
+    if (L == NULL)
+        return NULL;
+
+    luaL_openlibs(L);
+
+    for (const luaL_Reg *native = natives; native->name != NULL; native++)
+        lua_register(L, native->name, native->func);
+
+    lua_getglobal(L, "pcall");
+    yieldable_refs[0] = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_getglobal(L, "xpcall");
+    yieldable_refs[1] = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_getglobal(L, "package");
+    lua_pushfstring(L, "%s/?.lua;%s/?/init.lua;", lua_dir, lua_dir);
+    lua_getfield(L, -2, "path");
+    lua_concat(L, 2);
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);
+
+    snprintf(rt, sizeof(rt), "%s/rt.lua", lua_dir);
+
+    if (luaL_dofile(L, rt) != 0) {
+        report(L);
+        lua_close(L);
+        return NULL;
+    }
+
+    return L;
+}
+
+void script_host_close(lua_State *L)
+{
+    preempt_job = NULL;
+    lua_close(L);
+}
+
+bool script_host_step(lua_State *L, double budget)
+{
+    lua_getglobal(L, "__OpenPNGStudio_DO_NOT_POKE_rt_spin_once");
+    lua_pushnumber(L, budget);
+
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+        report(L);
+        return false;
+    }
+
+    return true;
+}
+
+void script_host_wake(lua_State *L, int job, const char *data, size_t len)
+{
+    lua_getglobal(L, "__OpenPNGStudio_DO_NOT_POKE_rt_wake");
+    lua_pushinteger(L, job);
+
+    if (data != NULL)
+        lua_pushlstring(L, data, len);
+    else
+        lua_pushnil(L);
+
+    if (lua_pcall(L, 2, 0, 0) != 0)
+        report(L);
+}
@@ -2,6 +2,7 @@
 #include <jxl/codestream_header.h>
 #include <jxl/decode.h>
 #include <jxl/decode_cxx.h>
+#include <jxl/parallel_runner.h>
 #include <jxl/resizable_parallel_runner.h>
 #include <jxl/resizable_parallel_runner_cxx.h>
 #include <jxl/types.h>
@@ -13,17 +14,40 @@
 extern "C" {
 #ifndef OPNG_STANDALONE
 #include <raylib.h>
+#include <core/pool.h>
 
-bool load_jpegxl(Image *out, const uint8_t *memory, const size_t size, int *nframes, int **delays)
+/* hands libjxl's parallel sections to the shared decoder pool */
+static JxlParallelRetCode pool_runner(void *runner_opaque, void *jpegxl_opaque,
+    JxlParallelRunInit init, JxlParallelRunFunction func, uint32_t start_range,
+    uint32_t end_range)
 {
-    JxlResizableParallelRunnerPtr runner = JxlResizableParallelRunnerMake(nullptr);
+    (void) runner_opaque;
+
+    const JxlParallelRetCode ret = init(jpegxl_opaque, pool_threads());
+    if (ret != JXL_PARALLEL_RET_SUCCESS)
+        return ret;
+
+    struct Run {
+        void *opaque;
+        JxlParallelRunFunction func;
+    } run = { jpegxl_opaque, func };
+
+    pool_parallel_for(start_range, end_range, [](void *ctx, uint32_t index, size_t thread) {
+        const auto *run = static_cast<Run*>(ctx);
+        run->func(run->opaque, index, thread);
+    }, &run);
+
+    return JXL_PARALLEL_RET_SUCCESS;
+}
 
+bool load_jpegxl(Image *out, const uint8_t *memory, const size_t size, int *nframes, int **delays)
+{
     JxlDecoderPtr decoder = JxlDecoderMake(nullptr);
     if (JxlDecoderSubscribeEvents(decoder.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE
         | JXL_DEC_FRAME) != JXL_DEC_SUCCESS)
         return false;
 
-    if (JxlDecoderSetParallelRunner(decoder.get(), JxlResizableParallelRunner, runner.get()) !=
+    if (JxlDecoderSetParallelRunner(decoder.get(), pool_runner, nullptr) !=
         JXL_DEC_SUCCESS)
         return false;
 
@@ -54,8 +78,6 @@ bool load_jpegxl(Image *out, const uint8_t *memory, const size_t size, int *nfra
             out->height = static_cast<int>(info.ysize);
             out->format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
             out->mipmaps = 1;
-            JxlResizableParallelRunnerSetThreads(runner.get(),
-                JxlResizableParallelRunnerSuggestThreads(info.xsize, info.ysize));
             break;
         case JXL_DEC_NEED_IMAGE_OUT_BUFFER:
         {
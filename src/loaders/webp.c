@@ -15,7 +15,8 @@ bool load_webp(Image *out, const uint8_t *memory, const size_t size, int *nframe
     WebPAnimDecoderOptions options;
     WebPAnimDecoderOptionsInit(&options);
     options.color_mode = MODE_RGBA;
-    options.use_threads = true;
+    /* already on a loader thread, a private one only oversubscribes the CPU */
+    options.use_threads = false;
 
     WebPAnimDecoder *decoder = WebPAnimDecoderNew(&data, &options);
     WebPAnimInfo anim_info;